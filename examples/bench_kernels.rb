@@ -0,0 +1,33 @@
+#!/usr/bin/env ruby
+#
+# Compares the learning speed of the size specialized kernels with the
+# generic kernel for the network shapes, that have one.
+#
+require 'neuro'
+require 'benchmark'
+
+include Neuro
+
+def load_generic(network)
+  old, ENV['NEURO_KERNEL'] = ENV['NEURO_KERNEL'], 'generic'
+  Network.load(network.dump)
+ensure
+  ENV['NEURO_KERNEL'] = old
+end
+
+n = (ARGV.shift || 100).to_i
+[ [ 4, 8, 1 ], [ 5, 2, 1 ] ].each do |shape|
+  data = Array.new(shape[0]) { rand }
+  desired = Array.new(shape[2]) { rand }
+  specialized = Network.new(*shape)
+  generic = load_generic(specialized)
+  puts "#{shape * 'x'} network, #{n} learn calls:"
+  Benchmark.bm(20) do |x|
+    [ specialized, generic ].each do |network|
+      x.report("learn #{network.stats[:kernel]}") do
+        n.times { network.learn(data, desired, 1.0E-300, 0.2) }
+      end
+    end
+  end
+  puts
+end
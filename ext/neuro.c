@@ -1,6 +1,8 @@
 #include "ruby.h"
 #include <assert.h>
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
 
 #define CAST2FLOAT(obj) \
     if (TYPE(obj) != T_FLOAT && rb_respond_to(obj, id_to_f)) \
@@ -17,6 +19,7 @@
         network->output_layer, network->tmp_hidden)
 #define DEFAULT_MAX_ITERATIONS  10000
 #define DEFAULT_DEBUG_STEP      1000
+#define GENERIC_KERNEL          "generic"
 
 static VALUE rb_mNeuro, rb_cNetwork, rb_cNeuroError;
 static ID id_to_f, id_class, id_name;
@@ -29,7 +32,18 @@ typedef struct NodeStruct {
     double   output;
 } Node;
 
+struct NetworkStruct;
+
+typedef struct KernelStruct {
+    const char *name;
+    int input_size;
+    int hidden_size;
+    int output_size;
+    long (*learn)(struct NetworkStruct *network, double max_error, double eta);
+} Kernel;
+
 typedef struct NetworkStruct {
+    const Kernel *kernel;
     int input_size;
     int hidden_size;
     int output_size;
@@ -44,6 +58,9 @@ typedef struct NetworkStruct {
     double *tmp_output;
 } Network;
 
+static const Kernel *Kernel_select(int input_size, int hidden_size,
+    int output_size);
+
 /* Node methods */
 
 static Node *Node_create(long weights)
@@ -112,6 +129,7 @@ static void Network_init(Network *network, int input_size, int hidden_size,
     if (hidden_size <= 0) rb_raise(rb_cNeuroError, "hidden_size <= 0");
     if (output_size <= 0) rb_raise(rb_cNeuroError, "output_size <= 0");
     if (learned < 0) rb_raise(rb_cNeuroError, "learned < 0");
+    network->kernel      = Kernel_select(input_size, hidden_size, output_size);
     network->input_size  = input_size;
     network->hidden_size = hidden_size;
     network->output_size = output_size;
@@ -213,50 +231,44 @@ static void feed2layer(int in_size, int out_size, Node **layer, double *data)
 }
 
 /*
- * Ruby API
+ * Kernels
  */
 
-/*
- * call-seq: learn(data, desired, max_error, eta)
- *
- * The network should respond with the Array _desired_ (size == output_size),
- * if it was given the Array _data_ (size == input_size). The learning process
- * ends, if the resulting error sinks below _max_error_ and convergence is
- * assumed. A lower _eta_ parameter leads to slower learning, because of low
- * weight changes. A too high _eta_ can lead to wildly oscillating weights, and
- * result in slower learning or no learning at all. The last two parameters
- * should be chosen appropriately to the problem at hand. ;)
- *
- * The return value is an Integer value, that denotes the number of learning
- * steps, which were necessary, to learn the _data_, or _max_iterations_, if
- * the _data_ couldn't be learned.
- */
-static VALUE rb_network_learn(VALUE self, VALUE data, VALUE desired, VALUE
-        max_error, VALUE eta)
+static void Network_load_weights(Network *network, double *hidden_weights,
+    double *output_weights)
 {
-    Network *network;
-    double max_error_float, eta_float, error, sum,
-        *output_delta, *hidden_delta;
-    long i, j, count;
-
-    Data_Get_Struct(self, Network, network);
+    int i;
+    for (i = 0; i < network->hidden_size; i++)
+        MEMCPY(hidden_weights + i * network->input_size,
+            network->hidden_layer[i]->weights, double, network->input_size);
+    for (i = 0; i < network->output_size; i++)
+        MEMCPY(output_weights + i * network->hidden_size,
+            network->output_layer[i]->weights, double, network->hidden_size);
+}
 
-	Check_Type(data, T_ARRAY);
-    if (RARRAY_LEN(data) != network->input_size)
-        rb_raise(rb_cNeuroError, "size of data != input_size");
-    transform_data(network->tmp_input, data);
+static void Network_store_weights(Network *network, double *hidden_weights,
+    double *output_weights, double *hidden, double *output)
+{
+    int i;
+    for (i = 0; i < network->hidden_size; i++) {
+        MEMCPY(network->hidden_layer[i]->weights,
+            hidden_weights + i * network->input_size, double,
+            network->input_size);
+        network->hidden_layer[i]->output = hidden[i];
+    }
+    for (i = 0; i < network->output_size; i++) {
+        MEMCPY(network->output_layer[i]->weights,
+            output_weights + i * network->hidden_size, double,
+            network->hidden_size);
+        network->output_layer[i]->output = output[i];
+    }
+}
 
-	Check_Type(desired, T_ARRAY);
-    if (RARRAY_LEN(desired) != network->output_size)
-        rb_raise(rb_cNeuroError, "size of desired != output_size");
-    transform_data(network->tmp_output, desired);
-    CAST2FLOAT(max_error);
-    max_error_float = RFLOAT_VALUE(max_error);
-    if (max_error_float <= 0) rb_raise(rb_cNeuroError, "max_error <= 0");
-    max_error_float *= 2.0;
-    CAST2FLOAT(eta);
-    eta_float = RFLOAT_VALUE(eta);
-    if (eta_float <= 0) rb_raise(rb_cNeuroError, "eta <= 0");
+static long Kernel_generic_learn(Network *network, double max_error,
+    double eta)
+{
+    double error, sum, *output_delta, *hidden_delta;
+    long i, j, count;
 
     output_delta = ALLOCA_N(double, network->output_size);
     hidden_delta = ALLOCA_N(double, network->hidden_size);
@@ -276,10 +288,10 @@ static VALUE rb_network_learn(VALUE self, VALUE data, VALUE desired, VALUE
         }
 
         if (count % network->debug_step == 0)
-            Network_debug_error(network, count, error, max_error_float);
+            Network_debug_error(network, count, error, max_error);
 
         /* Get out if error is below max_error ^ 2 */
-        if (error < max_error_float) goto CONVERGED;
+        if (error < max_error) return count;
 
         /* Compute hidden weight deltas */
         
@@ -298,16 +310,174 @@ static VALUE rb_network_learn(VALUE self, VALUE data, VALUE desired, VALUE
 		for (i = 0; i < network->output_size; i++)
 			for (j = 0; j < network->hidden_size; j++)
                 network->output_layer[i]->weights[j] +=
-                    eta_float * output_delta[i] *
+                    eta * output_delta[i] *
                     network->hidden_layer[j]->output;
 
 		for (i = 0; i < network->hidden_size; i++)
 			for (j = 0; j < network->input_size; j++)
-				network->hidden_layer[i]->weights[j] += eta_float *
+				network->hidden_layer[i]->weights[j] += eta *
                     hidden_delta[i] * network->tmp_input[j];
     }
     Network_debug_bail_out(network);
-CONVERGED:
+    return count;
+}
+
+/*
+ * Defines a learn kernel for networks of the fixed shape _in_ x _hid_ x _out_.
+ * All loop bounds are compile-time constants, and the kernel works on local
+ * copies of the weights and node outputs, which are only written back to the
+ * Node structs when learning ends or a debugging message is about to be
+ * printed. The copies live on the C stack and are made on every call to
+ * #learn, so only small shapes should get a kernel.
+ */
+#define DEFINE_KERNEL(in, hid, out) \
+static long Kernel_learn_##in##x##hid##x##out(Network *network, \
+    double max_error, double eta) \
+{ \
+    double hidden_weights[hid][in], output_weights[out][hid], \
+        hidden[hid], output[out], hidden_delta[hid], output_delta[out], \
+        input[in], desired[out], error, sum; \
+    long i, j, count; \
+    MEMCPY(input, network->tmp_input, double, in); \
+    MEMCPY(desired, network->tmp_output, double, out); \
+    Network_load_weights(network, &hidden_weights[0][0], \
+        &output_weights[0][0]); \
+    for (count = 0; count < network->max_iterations; count++) { \
+        for (i = 0; i < hid; i++) { \
+            sum = 0.0; \
+            for (j = 0; j < in; j++) \
+                sum += hidden_weights[i][j] * input[j]; \
+            hidden[i] = 1.0 / (1.0 + exp(-sum)); \
+        } \
+        for (i = 0; i < out; i++) { \
+            sum = 0.0; \
+            for (j = 0; j < hid; j++) \
+                sum += output_weights[i][j] * hidden[j]; \
+            output[i] = 1.0 / (1.0 + exp(-sum)); \
+        } \
+        error = 0.0; \
+        for (i = 0; i < out; i++) { \
+            output_delta[i] = desired[i] - output[i]; \
+            error += output_delta[i] * output_delta[i]; \
+            output_delta[i] *= output[i] * (1.0 - output[i]); \
+        } \
+        if (count % network->debug_step == 0 && !NIL_P(network->debug)) { \
+            Network_store_weights(network, &hidden_weights[0][0], \
+                &output_weights[0][0], hidden, output); \
+            Network_debug_error(network, count, error, max_error); \
+        } \
+        if (error < max_error) break; \
+        for (i = 0; i < hid; i++) { \
+            sum = 0.0; \
+            for (j = 0; j < out; j++) \
+                sum += output_delta[j] * output_weights[j][i]; \
+            hidden_delta[i] = sum * hidden[i] * (1.0 - hidden[i]); \
+        } \
+        for (i = 0; i < out; i++) \
+            for (j = 0; j < hid; j++) \
+                output_weights[i][j] += eta * output_delta[i] * hidden[j]; \
+        for (i = 0; i < hid; i++) \
+            for (j = 0; j < in; j++) \
+                hidden_weights[i][j] += eta * hidden_delta[i] * input[j]; \
+    } \
+    Network_store_weights(network, &hidden_weights[0][0], \
+        &output_weights[0][0], hidden, output); \
+    if (count == network->max_iterations) Network_debug_bail_out(network); \
+    return count; \
+}
+
+/*
+ * Shapes, that get their own kernels: the parity and even/odd networks from
+ * the tests subdirectory.
+ */
+#define KERNEL_SHAPES(shape) \
+    shape(4, 8, 1) \
+    shape(5, 2, 1)
+
+#define KERNEL_ENTRY(in, hid, out) \
+    { #in "x" #hid "x" #out, in, hid, out, \
+        Kernel_learn_##in##x##hid##x##out },
+
+KERNEL_SHAPES(DEFINE_KERNEL)
+
+static const Kernel kernels[] = {
+    KERNEL_SHAPES(KERNEL_ENTRY)
+};
+
+static const Kernel generic_kernel = {
+    GENERIC_KERNEL, 0, 0, 0, Kernel_generic_learn
+};
+
+/*
+ * Returns the kernel for networks of the given shape. This is the generic
+ * kernel, if there is no specialized one or if the environment variable
+ * NEURO_KERNEL is set to "generic". Any other nonempty value of NEURO_KERNEL
+ * raises a NetworkError.
+ */
+static const Kernel *Kernel_select(int input_size, int hidden_size,
+    int output_size)
+{
+    const char *setting = getenv("NEURO_KERNEL");
+    unsigned long i;
+    if (setting && *setting) {
+        if (strcmp(setting, GENERIC_KERNEL))
+            rb_raise(rb_cNeuroError, "unknown NEURO_KERNEL \"%s\"", setting);
+        return &generic_kernel;
+    }
+    for (i = 0; i < sizeof(kernels) / sizeof(Kernel); i++) {
+        if (kernels[i].input_size == input_size &&
+            kernels[i].hidden_size == hidden_size &&
+            kernels[i].output_size == output_size) return kernels + i;
+    }
+    return &generic_kernel;
+}
+
+/*
+ * Ruby API
+ */
+
+/*
+ * call-seq: learn(data, desired, max_error, eta)
+ *
+ * The network should respond with the Array _desired_ (size == output_size),
+ * if it was given the Array _data_ (size == input_size). The learning process
+ * ends, if the resulting error sinks below _max_error_ and convergence is
+ * assumed. A lower _eta_ parameter leads to slower learning, because of low
+ * weight changes. A too high _eta_ can lead to wildly oscillating weights, and
+ * result in slower learning or no learning at all. The last two parameters
+ * should be chosen appropriately to the problem at hand. ;)
+ *
+ * The return value is an Integer value, that denotes the number of learning
+ * steps, which were necessary, to learn the _data_, or _max_iterations_, if
+ * the _data_ couldn't be learned.
+ */
+static VALUE rb_network_learn(VALUE self, VALUE data, VALUE desired, VALUE
+        max_error, VALUE eta)
+{
+    Network *network;
+    double max_error_float, eta_float;
+    long count;
+
+    Data_Get_Struct(self, Network, network);
+
+	Check_Type(data, T_ARRAY);
+    if (RARRAY_LEN(data) != network->input_size)
+        rb_raise(rb_cNeuroError, "size of data != input_size");
+    transform_data(network->tmp_input, data);
+
+	Check_Type(desired, T_ARRAY);
+    if (RARRAY_LEN(desired) != network->output_size)
+        rb_raise(rb_cNeuroError, "size of desired != output_size");
+    transform_data(network->tmp_output, desired);
+    CAST2FLOAT(max_error);
+    max_error_float = RFLOAT_VALUE(max_error);
+    if (max_error_float <= 0) rb_raise(rb_cNeuroError, "max_error <= 0");
+    max_error_float *= 2.0;
+    CAST2FLOAT(eta);
+    eta_float = RFLOAT_VALUE(eta);
+    if (eta_float <= 0) rb_raise(rb_cNeuroError, "eta <= 0");
+
+    count = network->kernel->learn(network, max_error_float, eta_float);
     network->learned++;
     return INT2NUM(count);
 }
@@ -486,6 +656,22 @@ static VALUE rb_network_to_h(VALUE self)
     return Network_to_hash(network);
 }
 
+/*
+ * Returns a Hash with statistics about this Network: _kernel_ is the name of
+ * the kernel, that was selected for its shape, either "generic" or a size
+ * specialized one like "4x8x1", and _learned_ is the number of calls to
+ * #learn.
+ */
+static VALUE rb_network_stats(VALUE self)
+{
+    Network *network;
+    VALUE result = rb_hash_new();
+
+    Data_Get_Struct(self, Network, network);
+    rb_hash_aset(result, SYM("kernel"), rb_str_new2(network->kernel->name));
+    rb_hash_aset(result, SYM("learned"), INT2NUM(network->learned));
+    return result;
+}
 
 /*
  * Returns a short string for the network.
@@ -648,6 +834,7 @@ void Init_neuro()
     rb_define_method(rb_cNetwork, "dump", rb_network_dump, -1);
     rb_define_method(rb_cNetwork, "to_h", rb_network_to_h, 0);
     rb_define_method(rb_cNetwork, "to_s", rb_network_to_s, 0);
+    rb_define_method(rb_cNetwork, "stats", rb_network_stats, 0);
     rb_define_singleton_method(rb_cNetwork, "_load", rb_network_load, 1);
     rb_define_singleton_method(rb_cNetwork, "load", rb_network_load, 1);
     id_to_f = rb_intern("to_f");
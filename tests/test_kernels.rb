@@ -0,0 +1,99 @@
+#
+# Checks that size specialized kernels are selected for their shapes, and that
+# they learn exactly like the generic kernel.
+#
+require 'test/unit'
+require 'neuro'
+
+class TestKernels < Test::Unit::TestCase
+  include Neuro
+
+  # The shapes from KERNEL_SHAPES in ext/neuro.c.
+  SHAPES = [ [ 4, 8, 1 ], [ 5, 2, 1 ] ]
+
+  # Debugging IO, that records the state of its network on every write.
+  class Recorder
+    def initialize(network, fail_on = nil)
+      @network, @fail_on, @log = network, fail_on, []
+    end
+
+    attr_reader :log
+
+    def write(string)
+      @log << [ string, @network.to_h ]
+      @fail_on and string =~ @fail_on and raise IOError, string
+      string.size
+    end
+  end
+
+  def setenv(value)
+    old, ENV['NEURO_KERNEL'] = ENV['NEURO_KERNEL'], value
+    yield
+  ensure
+    ENV['NEURO_KERNEL'] = old
+  end
+
+  def generic(&block)
+    setenv('generic', &block)
+  end
+
+  def test_selection
+    SHAPES.each do |shape|
+      assert_equal shape * 'x', Network.new(*shape).stats[:kernel]
+      generic do
+        assert_equal 'generic', Network.new(*shape).stats[:kernel]
+      end
+    end
+    assert_equal 'generic', Network.new(3, 3, 3).stats[:kernel]
+  end
+
+  def test_unknown_kernel
+    setenv('4x8x1') do
+      assert_raise(NetworkError) { Network.new(4, 8, 1) }
+    end
+  end
+
+  def test_load_selects_kernel
+    network = Network.load(Network.new(5, 2, 1).dump)
+    assert_equal '5x2x1', network.stats[:kernel]
+  end
+
+  def test_same_results_as_generic
+    SHAPES.each do |shape|
+      specialized = Network.new(*shape)
+      network = generic { Network.load(specialized.dump) }
+      assert_equal 'generic', network.stats[:kernel]
+      [ specialized, network ].each do |n|
+        n.debug = Recorder.new(n)
+        n.debug_step = 7
+        n.max_iterations = 30
+      end
+      data = Array.new(shape[0]) { |i| i % 2 }
+      [ [ 0.9, 1.0E-300 ], [ 0.1, 1.0E-300 ], [ 0.9, 0.2 ] ].each do |d, e|
+        desired = Array.new(shape[2], d)
+        assert_equal network.learn(data, desired, e, 0.2),
+          specialized.learn(data, desired, e, 0.2)
+      end
+      assert_operator specialized.debug.log.size, :>, 0
+      assert_equal network.debug.log, specialized.debug.log
+      assert_equal network.to_h, specialized.to_h
+      assert_equal network.decide(data), specialized.decide(data)
+    end
+  end
+
+  def test_same_state_after_debug_error
+    SHAPES.each do |shape|
+      specialized = Network.new(*shape)
+      network = generic { Network.load(specialized.dump) }
+      [ specialized, network ].each do |n|
+        n.debug = Recorder.new(n, /converge/)
+        n.max_iterations = 30
+        data = Array.new(shape[0]) { |i| i % 2 }
+        desired = Array.new(shape[2], 0.9)
+        assert_raise(IOError) { n.learn(data, desired, 1.0E-300, 0.2) }
+      end
+      assert_equal network.debug.log, specialized.debug.log
+      assert_equal network.to_h, specialized.to_h
+    end
+  end
+end